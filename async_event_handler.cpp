@@ -2,6 +2,8 @@
 
 namespace el_async{
 
+thread_local AsyncEventHandler* AsyncEventHandler::executing_handler_ = nullptr;
+
 AsyncEventHandler::AsyncEventHandler() :
 		semaphore_(0) {
 	thread_status_ = 0;
@@ -9,6 +11,8 @@ AsyncEventHandler::AsyncEventHandler() :
 	thread_ = nullptr;
 	errcode_ = 0;
 	handlerfunc_ = nullptr;
+	trigger_hook_.store(nullptr);
+	trigger_hook_ctx_ = nullptr;
 	event_param_table_mem_ = nullptr;
 	event_param_table_mem_capacity_ = 0;
 	event_queue_ = nullptr;
@@ -17,6 +21,13 @@ AsyncEventHandler::AsyncEventHandler() :
 	first_empty_index_ = 0;
 	next_to_execute_index_ = 0;
 	event_queue_enable_ = false;
+	continuation_stack_ = nullptr;
+	continuation_stack_capacity_ = 0;
+	continuation_top_index_ = 0;
+	continuation_head_index_ = 0;
+	continuation_depth_ = 0;
+	continuation_depth_limit_ = 0;
+	continuation_order_ = ContinuationLIFO;
 }
 
 void AsyncEventHandler::handler_bind(handlerfunc_t func) {
@@ -33,6 +44,27 @@ void AsyncEventHandler::handler_unbind() {
 	handlerfunc_ = nullptr;
 }
 
+void AsyncEventHandler::trigger_hook_bind(triggerhookfunc_t func, void *ctx) {
+	//func(ctx, event) is called for every event accepted by event_trigger() and
+	//by the inline event_continue() path, always with the mutex held, event index already wrapped
+	//queued events are reported in queue order; continuations and their queue fallbacks
+	//are reported from the handler thread, so they show up as one more producer
+	//keep it short and don't call back into this object
+	if (errcode_ != NoError)
+		return;
+	std::unique_lock<std::mutex> lk(access_mutex_);
+	trigger_hook_.store(func);
+	trigger_hook_ctx_ = ctx;
+}
+
+void AsyncEventHandler::trigger_hook_unbind() {
+	if (errcode_ != NoError)
+		return;
+	std::unique_lock<std::mutex> lk(access_mutex_);
+	trigger_hook_.store(nullptr);
+	trigger_hook_ctx_ = nullptr;
+}
+
 void AsyncEventHandler::thread_bind(std::thread *thr) {
 	if (errcode_ != NoError)
 		return;
@@ -113,6 +145,12 @@ void AsyncEventHandler::event_bind_param_table_memory(void *memory,
 	}
 	capacity_counter++;
 	event_param_table_mem_capacity_ = capacity_counter;
+	//raw memory may hold anything, an odd version_ would look like a writer that never finishes
+	//all events start disabled, args are left as they are
+	for (int i = 0; i < capacity_counter; i++) {
+		((handler_params*) (memory))[i].enable_.store(0, std::memory_order_relaxed);
+		((handler_params*) (memory))[i].version_.store(0, std::memory_order_relaxed);
+	}
 	return;
 }
 int AsyncEventHandler::event_capacity() {
@@ -120,24 +158,23 @@ int AsyncEventHandler::event_capacity() {
 }
 bool AsyncEventHandler::event_bind(int event, void *arg0, void *arg1, int arg2,
 		int arg3) {
+	//lock-free, params are published through the per-event seqlock
 	if (errcode_ != NoError)
 		return false;
-	std::unique_lock<std::mutex> lk(access_mutex_);
-	if (event_param_table_mem_ == nullptr) {
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock); //error path only
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+			lk.lock();
 			errcode_ = InvalidParamTableObject;
 			return false;
 	}
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return false; //out of bounds
 	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
-	((handler_params*) (event_param_table_mem_))[event].enable_ = 0;
-	((handler_params*) (event_param_table_mem_))[event].arg0 = arg0;
-	((handler_params*) (event_param_table_mem_))[event].arg1 = arg1;
-	((handler_params*) (event_param_table_mem_))[event].arg2 = arg2;
-	((handler_params*) (event_param_table_mem_))[event].arg3 = arg3;
+	param_table[event].enable_.store(0, std::memory_order_release);
+	event_params_store(&param_table[event], arg0, arg1, arg2, arg3);
 
 	return true;
 }
@@ -145,22 +182,20 @@ bool AsyncEventHandler::event_bind(int event, void *arg0, void *arg1, int arg2,
 void AsyncEventHandler::event_unbind(int event) {
 	if (errcode_ != NoError)
 		return;
-	std::unique_lock<std::mutex> lk(access_mutex_);
-	if (event_param_table_mem_ == nullptr) {
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock); //error path only
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+				lk.lock();
 				errcode_ = InvalidParamTableObject;
 				return;
 	}
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return; //out of bounds
 	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
-	((handler_params*) (event_param_table_mem_))[event].enable_ = 0;
-	((handler_params*) (event_param_table_mem_))[event].arg0 = nullptr;
-	((handler_params*) (event_param_table_mem_))[event].arg1 = nullptr;
-	((handler_params*) (event_param_table_mem_))[event].arg2 = 0;
-	((handler_params*) (event_param_table_mem_))[event].arg3 = 0;
+	param_table[event].enable_.store(0, std::memory_order_release);
+	event_params_store(&param_table[event], nullptr, nullptr, 0, 0);
 
 	//if you removed the event, but it was already in the event queue,
 	//it will still be in the queue, but disabled, so it will just skip
@@ -170,55 +205,60 @@ void AsyncEventHandler::event_unbind(int event) {
 }
 
 void AsyncEventHandler::event_enable(int event) {
+	//lock-free, doesn't contend with event_trigger() or the handler thread
 	if (errcode_ != NoError)
 		return;
-	std::unique_lock<std::mutex> lk(access_mutex_);
-	if (event_param_table_mem_ == nullptr) {
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock); //error path only
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+			lk.lock();
 			errcode_ = InvalidParamTableObject;
 			return;
 	}
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return; //out of bounds
 	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
-	((handler_params*) (event_param_table_mem_))[event].enable_ = 1;
+	param_table[event].enable_.store(1, std::memory_order_release);
 
 }
 void AsyncEventHandler::event_disable(int event) {
+	//lock-free, doesn't contend with event_trigger() or the handler thread
 	if (errcode_ != NoError)
 		return;
-	std::unique_lock<std::mutex> lk(access_mutex_);
-	if (event_param_table_mem_ == nullptr) {
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock); //error path only
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+				lk.lock();
 				errcode_ = InvalidParamTableObject;
 				return;
 		}
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return; //out of bounds
 	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
-	((handler_params*) (event_param_table_mem_))[event].enable_ = 0;
+	param_table[event].enable_.store(0, std::memory_order_release);
 
 }
 
 bool AsyncEventHandler::event_is_enabled(int event) {
 	if (errcode_ != NoError)
 		return false;
-	std::unique_lock<std::mutex> lk(access_mutex_);
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock); //error path only
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return false; //out of bounds
 	}
-	if (event_param_table_mem_ == nullptr) {
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+				lk.lock();
 				errcode_ = InvalidParamTableObject;
 				return false;
 	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event;
-	return (((handler_params*) (event_param_table_mem_))[event].enable_ != 0);
+	return (param_table[event].enable_.load(std::memory_order_acquire) != 0);
 }
 
 void AsyncEventHandler::event_queue_bind_memory(int *event_queue,
@@ -278,51 +318,180 @@ bool AsyncEventHandler::event_queue_is_enabled() {
 bool AsyncEventHandler::event_trigger(int event) {
 	if (errcode_ != NoError)
 		return false;
-	std::unique_lock<std::mutex> lk(access_mutex_);
+	std::unique_lock<std::mutex> lk(access_mutex_, std::defer_lock);
 
-	if (event_queue_ == nullptr) {
-			errcode_ = InvalidEventQueueObject;
-			return false;
-		}
-	if (event_param_table_mem_ == nullptr) {
+	//param table checks are lock-free, disabled events are rejected without touching the mutex
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+			lk.lock();
 			errcode_ = InvalidParamTableObject;
 			return false;
 	}
 
 	if (event_id_out_of_bounds(event)) {
-		errcode_ = EventOutOfBounds;
 		return false; //out of bounds
 	}
 
+	if (event < 0)
+		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
+
+	if (param_table[event].enable_.load(std::memory_order_acquire) == 0) {
+		lk.lock();
+		errcode_ = EventTriggerDisabled;
+		return false;
+	}
+
+	lk.lock();
+	if (event_queue_ == nullptr) {
+			errcode_ = InvalidEventQueueObject;
+			return false;
+		}
+
 	if (event_queue_level_ == event_queue_capacity_) {
 		errcode_ = EventQueueFull;
 		return false; //out of bounds or queue is full
 	}
 
+	event_queue_[first_empty_index_] = event;
+	first_empty_index_++;
+	first_empty_index_ %= event_queue_capacity_;
+	event_queue_level_++;
+	triggerhookfunc_t hook = trigger_hook_.load(std::memory_order_relaxed); //mutex is taken
+	if (hook != nullptr)
+		hook(trigger_hook_ctx_, event);
+
+	if (event_queue_enable_) {
+		lk.unlock();
+		semaphore_.release();
+	}
+	return true;
+}
+
+void AsyncEventHandler::event_continuation_bind_memory(int *continuation_stack,
+		int continuation_stack_elem_count) {
+	//bind before thread_start() or while the queue is disabled and idle,
+	//the handler thread reads these without the lock
+	if (errcode_ != NoError)
+		return;
+	std::unique_lock<std::mutex> lk(access_mutex_);
+	continuation_stack_ = continuation_stack;
+	continuation_stack_capacity_ = continuation_stack_elem_count;
+	continuation_top_index_ = 0;
+	continuation_head_index_ = 0;
+	continuation_depth_ = 0;
+	//depth limit is kept, so it can be set before or after binding memory
+}
+
+int AsyncEventHandler::event_continuation_capacity() {
+	return continuation_stack_capacity_;
+}
+
+void AsyncEventHandler::event_continuation_depth_limit(int depth_limit) {
+	//max number of continuations executed inline after one queued event,
+	//the rest goes through the event queue so it can't starve other producers
+	//0 (default): continuation stack capacity
+	//set before thread_start() or while the queue is disabled and idle,
+	//the handler thread reads it without the lock
+	if (errcode_ != NoError)
+		return;
+	std::unique_lock<std::mutex> lk(access_mutex_);
+	continuation_depth_limit_ = depth_limit;
+}
 
+void AsyncEventHandler::event_continuation_order(ContinuationOrder order) {
+	//set before thread_start() or while the queue is disabled and idle,
+	//the handler thread reads it without the lock
+	if (errcode_ != NoError)
+		return;
+	std::unique_lock<std::mutex> lk(access_mutex_);
+	continuation_order_ = order;
+}
 
+bool AsyncEventHandler::event_continue(int event) {
+	//handler thread only: executed right after the current handler returns,
+	//no lock, no semaphore, no waiting behind the event queue
+	if (errcode_ != NoError)
+		return false;
+	if (executing_handler_ != this) {
+		std::unique_lock<std::mutex> lk(access_mutex_);
+		errcode_ = ContinuationOutsideHandler;
+		return false;
+	}
+	int depth_limit = (continuation_depth_limit_ > 0) ?
+			continuation_depth_limit_ : continuation_stack_capacity_;
+	if ((continuation_stack_ == nullptr)
+			|| (continuation_top_index_ == continuation_stack_capacity_)
+			|| (continuation_depth_ + (continuation_top_index_ - continuation_head_index_)
+					>= depth_limit))
+		return event_trigger(event); //fall back to the event queue, sets error code
+
+	if (event_id_out_of_bounds(event)) {
+		return false; //out of bounds
+	}
 	if (event < 0)
 		event = event_param_table_mem_capacity_ + event; //if negative, wrap around from the end
 
-	bool event_enabled =
-			(((handler_params*) (event_param_table_mem_))[event].enable_ != 0);
-	if (event_enabled) {
-		event_queue_[first_empty_index_] = event;
-		first_empty_index_++;
-		first_empty_index_ %= event_queue_capacity_;
-		event_queue_level_++;
-	} else {
+	//same result as the event_trigger() fallback, disabled events are rejected here too
+	handler_params *param_table = (handler_params*) (event_param_table_mem_);
+	if (param_table == nullptr) {
+		std::unique_lock<std::mutex> lk(access_mutex_);
+		errcode_ = InvalidParamTableObject;
+		return false;
+	}
+	if (param_table[event].enable_.load(std::memory_order_acquire) == 0) {
+		std::unique_lock<std::mutex> lk(access_mutex_);
 		errcode_ = EventTriggerDisabled;
 		return false;
 	}
 
-	if (event_queue_enable_) {
-		lk.unlock();
-		semaphore_.release();
+	continuation_stack_[continuation_top_index_] = event;
+	continuation_top_index_++;
+	if (trigger_hook_.load(std::memory_order_relaxed) != nullptr) {
+		//only costs the lock while a hook is bound, ctx is read under it
+		std::unique_lock<std::mutex> lk(access_mutex_);
+		triggerhookfunc_t hook = trigger_hook_.load(std::memory_order_relaxed);
+		if (hook != nullptr)
+			hook(trigger_hook_ctx_, event);
 	}
 	return true;
 }
 
+void AsyncEventHandler::continuation_drain(handlerfunc_t hndlr) {
+	//handler thread only, mutex is not taken
+	//hndlr is the one the current queued event was executed with
+	while (continuation_top_index_ != continuation_head_index_) {
+		int event;
+		if (continuation_order_ == ContinuationLIFO) {
+			continuation_top_index_--;
+			event = continuation_stack_[continuation_top_index_];
+		} else {
+			event = continuation_stack_[continuation_head_index_];
+			continuation_head_index_++;
+		}
+		continuation_depth_++;
+
+		//the handler may push more, they are executed before we return
+		handler_params *param_table = (handler_params*) (event_param_table_mem_);
+		if (param_table == nullptr) {
+			std::unique_lock<std::mutex> lk(access_mutex_);
+			errcode_ = InvalidParamTableObject;
+			break;
+		}
+		void *arg0;
+		void *arg1;
+		int arg2;
+		int arg3;
+		int hndlr_en = event_params_load(&param_table[event], &arg0, &arg1, &arg2, &arg3);
+
+		if (hndlr_en == 1)
+			hndlr(arg0, arg1, arg2, arg3);
+	}
+	//whatever is left after an error is dropped
+	continuation_top_index_ = 0;
+	continuation_head_index_ = 0;
+	continuation_depth_ = 0;
+}
+
 void AsyncEventHandler::threadfunc() {
 	std::unique_lock<std::mutex> lk(access_mutex_);
 	thread_status_ = 1;
@@ -350,6 +519,7 @@ void AsyncEventHandler::threadfunc() {
 		void *arg1;
 		int arg2;
 		int arg3;
+		handler_params *param_table;
 		//process signals
 		switch (thread_signal_) {
 		case (1):
@@ -369,26 +539,27 @@ void AsyncEventHandler::threadfunc() {
 			goto event_loop_end;
 		}
 
-		//copy current params onto stack so we can have unlocked mutex during handler execution
 		event = event_queue_[next_to_execute_index_];
 		hndlr = handlerfunc_;
-		hndlr_en = ((handler_params*) (event_param_table_mem_))[event].enable_;
-		arg0 = ((handler_params*) (event_param_table_mem_))[event].arg0;
-		arg1 = ((handler_params*) (event_param_table_mem_))[event].arg1;
-		arg2 = ((handler_params*) (event_param_table_mem_))[event].arg2;
-		arg3 = ((handler_params*) (event_param_table_mem_))[event].arg3;
+		param_table = (handler_params*) (event_param_table_mem_);
 		next_to_execute_index_++;
 		next_to_execute_index_ %= event_queue_capacity_;
 		event_queue_level_--;
 		lk.unlock();
 
+		//copy current params onto stack through the seqlock, control plane writers don't block us
+		hndlr_en = event_params_load(&param_table[event], &arg0, &arg1, &arg2, &arg3);
+
 		if (hndlr_en == 1) {
 			if (hndlr == nullptr) {
 				this->event_queue_disable();
 				errcode_ = InvalidHandlerObject;
 				goto event_loop_end;
 			}
+			executing_handler_ = this; //event_continue() is only allowed while this is set
 			hndlr(arg0, arg1, arg2, arg3);
+			continuation_drain(hndlr);
+			executing_handler_ = nullptr;
 		}
 
 		event_loop_end: ;
@@ -398,15 +569,65 @@ void AsyncEventHandler::threadfunc() {
 }
 
 bool AsyncEventHandler::event_id_out_of_bounds(int event) {
-	//mutex is already taken, internal function
+	//mutex must NOT be taken, internal function, only locks to set error code
 	if (errcode_ != NoError)
 		goto end;
 	if ((event >= event_param_table_mem_capacity_)
 			|| (-event >= event_param_table_mem_capacity_)) {
+		std::unique_lock<std::mutex> lk(access_mutex_);
 		errcode_ = EventOutOfBounds;
 		return true;
 	}
 	end: return false;
 }
 
+void AsyncEventHandler::event_params_store(handler_params *params, void *arg0,
+		void *arg1, int arg2, int arg3) {
+	//seqlock writer: odd version_ while writing, writers serialize on version_ itself
+	unsigned int version = params->version_.load(std::memory_order_relaxed);
+	while (1) {
+		if (version & 1) {
+			std::this_thread::yield(); //another writer is inside
+			version = params->version_.load(std::memory_order_relaxed);
+			continue;
+		}
+		if (params->version_.compare_exchange_weak(version, version + 1,
+				std::memory_order_acquire, std::memory_order_relaxed))
+			break;
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	std::atomic_ref<void*>(params->arg0).store(arg0, std::memory_order_relaxed);
+	std::atomic_ref<void*>(params->arg1).store(arg1, std::memory_order_relaxed);
+	std::atomic_ref<int>(params->arg2).store(arg2, std::memory_order_relaxed);
+	std::atomic_ref<int>(params->arg3).store(arg3, std::memory_order_relaxed);
+	params->version_.store(version + 2, std::memory_order_release);
+}
+
+int AsyncEventHandler::event_params_load(handler_params *params, void **arg0,
+		void **arg1, int *arg2, int *arg3) {
+	//seqlock reader: retry if a writer was inside or finished while we were copying
+	//enable_ is read inside the same window: bind/unbind clear it before taking version_,
+	//so args from a bind/unbind are never paired with the enable of the previous binding
+	unsigned int version_begin;
+	unsigned int version_end;
+	int enable;
+	while (1) {
+		version_begin = params->version_.load(std::memory_order_acquire);
+		if (version_begin & 1) {
+			std::this_thread::yield(); //writer is inside, let it finish if it got preempted
+			continue;
+		}
+		enable = params->enable_.load(std::memory_order_acquire);
+		*arg0 = std::atomic_ref<void*>(params->arg0).load(std::memory_order_relaxed);
+		*arg1 = std::atomic_ref<void*>(params->arg1).load(std::memory_order_relaxed);
+		*arg2 = std::atomic_ref<int>(params->arg2).load(std::memory_order_relaxed);
+		*arg3 = std::atomic_ref<int>(params->arg3).load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		version_end = params->version_.load(std::memory_order_relaxed);
+		if (version_begin == version_end)
+			break;
+	}
+	return enable;
+}
+
 }
@@ -11,6 +11,7 @@
 #include <mutex>
 #include <thread>
 #include <semaphore>
+#include <atomic>
 
 namespace el_async{
 
@@ -26,8 +27,16 @@ public:
 			EventOutOfBounds = -5,
 			EventQueueFull = -6,
 			EventTriggerDisabled = -7,
+			ContinuationOutsideHandler = -8,
 	};
-	typedef struct arg_list{int enable_; void* arg0; void* arg1; int arg2; int arg3;} handler_params;
+	enum ContinuationOrder{
+			ContinuationLIFO = 0,
+			ContinuationFIFO = 1,
+	};
+	//contains atomics: enable_ is read and written without the lock,
+	//version_ is a seqlock over arg0..arg3 (odd while a writer is inside)
+	//both are reset by event_bind_param_table_memory(), so the table can be raw aligned memory
+	typedef struct arg_list{std::atomic<int> enable_; std::atomic<unsigned int> version_; void* arg0; void* arg1; int arg2; int arg3;} handler_params;
 private:
 	std::mutex access_mutex_;
 	std::thread* thread_; //pointer!
@@ -38,6 +47,9 @@ private:
 
 	typedef void (*handlerfunc_t)(void*, void*, int, int);
 	handlerfunc_t handlerfunc_;
+	typedef void (*triggerhookfunc_t)(void*, int);
+	std::atomic<triggerhookfunc_t> trigger_hook_; //optional, e.g. trace recording; atomic for the unlocked check in event_continue()
+	void* trigger_hook_ctx_;
 	void* event_param_table_mem_;
 	int event_param_table_mem_capacity_;
 
@@ -47,10 +59,22 @@ private:
 	int first_empty_index_;
 	int next_to_execute_index_;
 	bool event_queue_enable_;
+
+	//continuations: touched only by the handler thread, no lock needed
+	static thread_local AsyncEventHandler* executing_handler_; //set by the handler thread around handler calls
+	int* continuation_stack_;
+	int continuation_stack_capacity_;
+	int continuation_top_index_;
+	int continuation_head_index_;
+	int continuation_depth_;
+	int continuation_depth_limit_;
+	ContinuationOrder continuation_order_;
 public:
 	AsyncEventHandler();
 	void handler_bind(handlerfunc_t func);
 	void handler_unbind();
+	void trigger_hook_bind(triggerhookfunc_t func, void* ctx);
+	void trigger_hook_unbind();
 	void thread_bind(std::thread* thr);
 	void thread_unbind();
 	void thread_start();
@@ -73,9 +97,17 @@ public:
 	void event_queue_disable();
 	bool event_queue_is_enabled();
 	bool event_trigger(int event);
+	void event_continuation_bind_memory(int* continuation_stack, int continuation_stack_elem_count);
+	int event_continuation_capacity();
+	void event_continuation_depth_limit(int depth_limit);
+	void event_continuation_order(ContinuationOrder order);
+	bool event_continue(int event);
 private:
 	void threadfunc();
+	void continuation_drain(handlerfunc_t hndlr);
 	bool event_id_out_of_bounds(int event);
+	void event_params_store(handler_params* params, void* arg0, void* arg1, int arg2, int arg3);
+	int event_params_load(handler_params* params, void** arg0, void** arg1, int* arg2, int* arg3);
 
 };
 
@@ -0,0 +1,145 @@
+/*
+ * enable_trigger_bench.cpp
+ *
+ * Mixed control plane / data plane contention benchmark
+ * Producers trigger events 0..15
+ * Events 0..7 stay enabled, togglers keep disabling, rebinding and enabling 8..15
+ * so the handler thread copies params from slots that are being rewritten
+ * Every bind sets arg0 == arg1 == arg2 == arg3, the handler counts torn copies
+ * Bound values are > 0 for bindings that get enabled, < 0 for bindings that are
+ * never enabled, 0 after unbind; the handler counts any <= 0 it gets called with
+ *
+ * Error code is shared, a toggle can be a no-op while a producer's error is pending
+ * handled < triggers: events disabled after being queued are skipped by the handler thread
+ *
+ * usage: enable_trigger_bench [seconds] [producers] [togglers]
+ */
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include "../async_event_handler.h"
+
+static std::atomic<long long> handled_count(0);
+static std::atomic<long long> torn_count(0);
+static std::atomic<long long> disabled_handled_count(0);
+
+void bench_handler_function(void *arg0, void *arg1, int arg2, int arg3) {
+	if ((arg0 != arg1) || ((intptr_t) arg0 != (intptr_t) arg2) || (arg2 != arg3))
+		torn_count.fetch_add(1, std::memory_order_relaxed);
+	if (arg2 <= 0)
+		disabled_handled_count.fetch_add(1, std::memory_order_relaxed); //unbound or never enabled binding
+	handled_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+int main(int argc, char **argv) {
+	int seconds = (argc > 1) ? std::atoi(argv[1]) : 2;
+	int producer_count = (argc > 2) ? std::atoi(argv[2]) : 2;
+	int toggler_count = (argc > 3) ? std::atoi(argv[3]) : 2;
+
+	el_async::AsyncEventHandler::handler_params event_handler_param_table[16];
+	static int event_handler_event_queue[1024] = { 0 };
+	std::thread event_handler_thread;
+
+	el_async::AsyncEventHandler event_handler;
+	event_handler.event_bind_param_table_memory((void*) event_handler_param_table,
+			sizeof(event_handler_param_table));
+	event_handler.event_queue_bind_memory(event_handler_event_queue,
+			sizeof(event_handler_event_queue)
+					/ sizeof(event_handler_event_queue[0]));
+	event_handler.handler_bind(bench_handler_function);
+	event_handler.thread_bind(&event_handler_thread);
+	event_handler.thread_start();
+	for (int i = 0; i < 16; i++) {
+		event_handler.event_bind(i, (void*) (intptr_t) (i + 1), (void*) (intptr_t) (i + 1), i + 1, i + 1);
+		event_handler.event_enable(i);
+	}
+	event_handler.event_queue_enable();
+	while (!event_handler.thread_ready())
+		;
+	if (event_handler.error() != 0) {
+		std::cout << "bench: configuration failed" << std::endl;
+		return 1;
+	}
+
+	std::atomic<bool> running(true);
+	std::atomic<long long> trigger_count(0);
+	std::atomic<long long> trigger_disabled_count(0);
+	std::atomic<long long> trigger_full_count(0);
+	std::atomic<long long> toggle_count(0);
+	std::vector<std::thread> workers;
+
+	for (int p = 0; p < producer_count; p++) {
+		workers.emplace_back([&, p]() {
+			long long ok = 0;
+			long long disabled = 0;
+			long long full = 0;
+			int event = p;
+			while (running.load(std::memory_order_relaxed)) {
+				if (event_handler.event_trigger(event & 15)) {
+					ok++;
+				} else {
+					//error code is shared, someone else's may be the one we clear
+					int err = event_handler.error();
+					if (err == el_async::AsyncEventHandler::EventTriggerDisabled) {
+						disabled++;
+					} else {
+						full++;
+						event_handler.event_queue_enable(); //wake the handler thread in case it slept through the error
+						std::this_thread::yield();
+					}
+				}
+				event++;
+			}
+			trigger_count.fetch_add(ok);
+			trigger_disabled_count.fetch_add(disabled);
+			trigger_full_count.fetch_add(full);
+		});
+	}
+	for (int t = 0; t < toggler_count; t++) {
+		workers.emplace_back([&, t]() {
+			long long ops = 0;
+			int event = 8 + t;
+			while (running.load(std::memory_order_relaxed)) {
+				int e = 8 + (event & 7);
+				int v = (int) (ops & 0x3FFFFFFF) + 1;
+				event_handler.event_disable(e);
+				event_handler.event_unbind(e);
+				event_handler.event_bind(e, (void*) (intptr_t) -v, (void*) (intptr_t) -v, -v, -v); //never enabled
+				event_handler.event_bind(e, (void*) (intptr_t) v, (void*) (intptr_t) v, v, v);
+				event_handler.event_enable(e);
+				ops++;
+				event++;
+			}
+			toggle_count.fetch_add(ops);
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	running.store(false);
+	for (auto &w : workers)
+		w.join();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100)); //let the queue drain
+	event_handler.thread_stop_join();
+
+	std::cout << "bench: " << producer_count << " producers, " << toggler_count
+			<< " togglers, " << seconds << " s" << std::endl;
+	std::cout << "bench: triggers/s:             " << trigger_count.load() / seconds
+			<< std::endl;
+	std::cout << "bench: disabled triggers/s:    "
+			<< trigger_disabled_count.load() / seconds << std::endl;
+	std::cout << "bench: queue full/s:           " << trigger_full_count.load() / seconds
+			<< std::endl;
+	std::cout << "bench: toggle+rebind cycles/s: " << toggle_count.load() / seconds
+			<< std::endl;
+	std::cout << "bench: handled/s:              " << handled_count.load() / seconds
+			<< std::endl;
+	std::cout << "bench: torn param copies:      " << torn_count.load() << std::endl;
+	std::cout << "bench: disabled/unbound handled: " << disabled_handled_count.load()
+			<< std::endl;
+	return ((torn_count.load() == 0) && (disabled_handled_count.load() == 0)) ? 0 : 1;
+}
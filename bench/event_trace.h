@@ -0,0 +1,186 @@
+/*
+ * event_trace.h
+ *
+ * Trace of event triggers for trace_replay
+ * One record per accepted event_trigger() or inline event_continue(): (timestamp, producer, event, handler cost)
+ *
+ * Formats:
+ * - binary: "AEHT" magic, then 20-byte little-endian records
+ *   u64 timestamp_ns, u32 producer, i32 event, u32 cost_ns
+ * - CSV: header line "timestamp_ns,producer,event,cost_ns", then one record per line
+ *
+ * Recording from a running instance:
+ *   el_async::EventTraceRecorder recorder(1000000); //preallocated, records past that are dropped
+ *   my_event_handler.trigger_hook_bind(el_async::EventTraceRecorder::hook, &recorder);
+ *   ...
+ *   my_event_handler.trigger_hook_unbind();
+ *   recorder.save("my.trace", false); //true for CSV
+ * Handler cost isn't visible to the hook, it's recorded as 0
+ * (trace_replay --cost sets it, or edit the CSV)
+ * Inline event_continue() events are recorded too, as triggered by the handler thread
+ * (one extra producer), same as continuations that fell back to the queue
+ */
+
+#ifndef EVENT_TRACE_H_
+#define EVENT_TRACE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace el_async{
+
+typedef struct event_trace_record_t{
+	uint64_t timestamp_ns; //since start of the trace
+	uint32_t producer; //small producer index, not an OS thread ID
+	int32_t event;
+	uint32_t cost_ns; //synthetic handler cost
+} event_trace_record;
+
+static const char event_trace_magic[4] = { 'A', 'E', 'H', 'T' };
+
+inline void event_trace_put_le(unsigned char *dst, uint64_t value, int bytelen) {
+	for (int i = 0; i < bytelen; i++)
+		dst[i] = (unsigned char) (value >> (8 * i));
+}
+
+inline uint64_t event_trace_get_le(const unsigned char *src, int bytelen) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytelen; i++)
+		value |= ((uint64_t) src[i]) << (8 * i);
+	return value;
+}
+
+inline bool event_trace_save(const char *path,
+		const std::vector<event_trace_record> &records, bool csv) {
+	FILE *f = std::fopen(path, csv ? "w" : "wb");
+	if (f == nullptr)
+		return false;
+	bool ok = true;
+	if (csv) {
+		std::fprintf(f, "timestamp_ns,producer,event,cost_ns\n");
+		for (const event_trace_record &r : records)
+			std::fprintf(f, "%llu,%u,%d,%u\n",
+					(unsigned long long) r.timestamp_ns,
+					(unsigned int) r.producer, (int) r.event,
+					(unsigned int) r.cost_ns);
+	} else {
+		ok = (std::fwrite(event_trace_magic, 1, 4, f) == 4);
+		unsigned char buf[20];
+		for (const event_trace_record &r : records) {
+			event_trace_put_le(&buf[0], r.timestamp_ns, 8);
+			event_trace_put_le(&buf[8], r.producer, 4);
+			event_trace_put_le(&buf[12], (uint32_t) r.event, 4);
+			event_trace_put_le(&buf[16], r.cost_ns, 4);
+			if (std::fwrite(buf, 1, 20, f) != 20) {
+				ok = false;
+				break;
+			}
+		}
+	}
+	if (std::fclose(f) != 0)
+		ok = false;
+	return ok;
+}
+
+inline bool event_trace_load(const char *path,
+		std::vector<event_trace_record> &records) {
+	//format is detected by the magic, anything else is parsed as CSV
+	FILE *f = std::fopen(path, "rb");
+	if (f == nullptr)
+		return false;
+	records.clear();
+	char magic[4] = { 0 };
+	bool binary = (std::fread(magic, 1, 4, f) == 4)
+			&& (std::memcmp(magic, event_trace_magic, 4) == 0);
+	if (binary) {
+		unsigned char buf[20];
+		size_t got;
+		while ((got = std::fread(buf, 1, 20, f)) == 20) {
+			event_trace_record r;
+			r.timestamp_ns = event_trace_get_le(&buf[0], 8);
+			r.producer = (uint32_t) event_trace_get_le(&buf[8], 4);
+			r.event = (int32_t) (uint32_t) event_trace_get_le(&buf[12], 4);
+			r.cost_ns = (uint32_t) event_trace_get_le(&buf[16], 4);
+			records.push_back(r);
+		}
+		std::fclose(f);
+		return (got == 0); //truncated record
+	}
+	std::rewind(f);
+	char line[256];
+	while (std::fgets(line, sizeof(line), f) != nullptr) {
+		unsigned long long timestamp_ns;
+		unsigned int producer;
+		int event;
+		unsigned int cost_ns;
+		if (std::sscanf(line, "%llu,%u,%d,%u", &timestamp_ns, &producer,
+				&event, &cost_ns) != 4)
+			continue; //header, comments, empty lines
+		records.push_back( { (uint64_t) timestamp_ns, (uint32_t) producer,
+				(int32_t) event, (uint32_t) cost_ns });
+	}
+	std::fclose(f);
+	return true;
+}
+
+class EventTraceRecorder{
+private:
+	std::chrono::steady_clock::time_point start_;
+	std::vector<std::thread::id> producers_;
+	std::vector<event_trace_record> records_;
+	size_t record_capacity_;
+	size_t producer_capacity_;
+	long long dropped_;
+public:
+	//everything is allocated up front, the hook runs under the queue lock
+	//and must not reallocate (that would stall every producer and distort the trace)
+	EventTraceRecorder(size_t record_capacity, size_t producer_capacity = 64) :
+			start_(std::chrono::steady_clock::now()), record_capacity_(
+					record_capacity), producer_capacity_(producer_capacity), dropped_(
+					0) {
+		records_.reserve(record_capacity);
+		producers_.reserve(producer_capacity);
+	}
+	static void hook(void *ctx, int event) {
+		//called by AsyncEventHandler with its mutex held, no extra locking needed
+		//as long as only one AsyncEventHandler records into this object
+		EventTraceRecorder *self = (EventTraceRecorder*) ctx;
+		if (self->records_.size() == self->record_capacity_) {
+			self->dropped_++;
+			return;
+		}
+		std::thread::id id = std::this_thread::get_id();
+		uint32_t producer = 0;
+		while (producer < self->producers_.size()
+				&& self->producers_[producer] != id)
+			producer++;
+		if (producer == self->producers_.size()) {
+			if (producer == self->producer_capacity_) {
+				self->dropped_++;
+				return;
+			}
+			self->producers_.push_back(id);
+		}
+		uint64_t timestamp_ns = (uint64_t) std::chrono::duration_cast<
+				std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - self->start_).count();
+		self->records_.push_back( { timestamp_ns, producer, (int32_t) event, 0 });
+	}
+	const std::vector<event_trace_record>& records() {
+		return records_;
+	}
+	long long dropped() {
+		return dropped_;
+	}
+	bool save(const char *path, bool csv) {
+		return event_trace_save(path, records_, csv);
+	}
+};
+
+}
+
+#endif /* EVENT_TRACE_H_ */
@@ -0,0 +1,343 @@
+/*
+ * trace_replay.cpp
+ *
+ * Replays an event trace (see event_trace.h) into an AsyncEventHandler
+ * Records are split between producer threads by their producer index,
+ * each handler call busy-waits for the record's cost
+ *
+ * Reports throughput, queue depth over time and end-to-end latency percentiles
+ * Latency is measured from when the trigger was due (the record's timestamp,
+ * or the first event_trigger() attempt with --fast) to handler finished,
+ * so lock waits and queue full retries are included
+ * Accepted by event_trigger() -> handler finished is reported as a secondary number
+ *
+ * usage: trace_replay <trace> [options]
+ *   --fast           trigger as fast as possible instead of following timestamps
+ *   --producers N    number of producer threads (default: as many as in the trace)
+ *   --queue N        event queue capacity (default 1024)
+ *   --cost NS        handler cost for records with cost 0 (default 0)
+ *   --sample-us N    queue depth sampling interval (default 1000)
+ *   --depth-out F    write the full queue depth series to F as CSV
+ */
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../async_event_handler.h"
+#include "event_trace.h"
+
+typedef std::chrono::steady_clock replay_clock;
+
+typedef struct replay_stamp_t{
+	replay_clock::time_point due;
+	replay_clock::time_point accepted;
+	uint32_t cost_ns;
+} replay_stamp;
+
+typedef struct replay_depth_sample_t{
+	double t_ms;
+	long long depth;
+} replay_depth_sample;
+
+typedef struct replay_context_t{
+	std::vector<replay_stamp> stamps; //ring, written in queue order by the trigger hook
+	long long enqueued; //hook only, queue lock held
+	std::atomic<long long> enqueued_count;
+	long long handled; //handler thread only
+	std::atomic<long long> handled_count;
+	std::vector<uint64_t> latency_ns; //handler thread only, due -> handled
+	std::vector<uint64_t> accepted_latency_ns; //handler thread only, accepted -> handled
+} replay_context;
+
+//set by the producer before event_trigger(), read by the hook on the same thread
+static thread_local uint32_t replay_pending_cost_ns = 0;
+static thread_local replay_clock::time_point replay_pending_due;
+
+static void replay_trigger_hook(void *ctx, int event) {
+	//producer thread, queue lock held: stamps land in the same order the handler pops events
+	replay_context *rc = (replay_context*) ctx;
+	replay_stamp &s = rc->stamps[rc->enqueued % rc->stamps.size()];
+	s.due = replay_pending_due;
+	s.accepted = replay_clock::now();
+	s.cost_ns = replay_pending_cost_ns;
+	rc->enqueued++;
+	rc->enqueued_count.store(rc->enqueued, std::memory_order_release);
+}
+
+static void replay_handler_function(void *arg0, void *arg1, int arg2, int arg3) {
+	replay_context *rc = (replay_context*) arg0;
+	replay_stamp s = rc->stamps[rc->handled % rc->stamps.size()];
+	if (s.cost_ns != 0) {
+		replay_clock::time_point until = replay_clock::now()
+				+ std::chrono::nanoseconds(s.cost_ns);
+		while (replay_clock::now() < until)
+			; //synthetic handler cost
+	}
+	replay_clock::time_point handled = replay_clock::now();
+	rc->latency_ns.push_back(
+			(uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+					handled - s.due).count());
+	rc->accepted_latency_ns.push_back(
+			(uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+					handled - s.accepted).count());
+	rc->handled++;
+	rc->handled_count.store(rc->handled, std::memory_order_release);
+}
+
+static double replay_percentile_us(const std::vector<uint64_t> &sorted, double p) {
+	if (sorted.empty())
+		return 0.0;
+	size_t i = (size_t) (p * (double) (sorted.size() - 1) + 0.5);
+	return sorted[i] / 1000.0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cout << "usage: trace_replay <trace> [--fast] [--producers N] [--queue N]"
+				<< " [--cost NS] [--sample-us N] [--depth-out F]" << std::endl;
+		return 1;
+	}
+	const char *trace_path = argv[1];
+	bool fast = false;
+	int producer_count = 0;
+	int queue_capacity = 1024;
+	uint32_t default_cost_ns = 0;
+	int sample_us = 1000;
+	const char *depth_out_path = nullptr;
+	for (int i = 2; i < argc; i++) {
+		if (std::strcmp(argv[i], "--fast") == 0)
+			fast = true;
+		else if (std::strcmp(argv[i], "--producers") == 0 && i + 1 < argc)
+			producer_count = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--queue") == 0 && i + 1 < argc)
+			queue_capacity = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--cost") == 0 && i + 1 < argc)
+			default_cost_ns = (uint32_t) std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--sample-us") == 0 && i + 1 < argc)
+			sample_us = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--depth-out") == 0 && i + 1 < argc)
+			depth_out_path = argv[++i];
+		else {
+			std::cout << "replay: unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+	if (queue_capacity < 1 || sample_us < 1) {
+		std::cout << "replay: bad --queue or --sample-us" << std::endl;
+		return 1;
+	}
+
+	std::vector<el_async::event_trace_record> records;
+	if (!el_async::event_trace_load(trace_path, records) || records.empty()) {
+		std::cout << "replay: can't read trace " << trace_path << std::endl;
+		return 1;
+	}
+	std::stable_sort(records.begin(), records.end(),
+			[](const el_async::event_trace_record &a,
+					const el_async::event_trace_record &b) {
+				return a.timestamp_ns < b.timestamp_ns;
+			});
+
+	//size the param table so every event ID in the trace, negative ones included, is in bounds
+	int event_capacity = 1;
+	uint32_t max_producer = 0;
+	for (el_async::event_trace_record &r : records) {
+		int needed = (r.event >= 0) ? (r.event + 1) : (-r.event + 1);
+		event_capacity = std::max(event_capacity, needed);
+		max_producer = std::max(max_producer, r.producer);
+		if (r.cost_ns == 0)
+			r.cost_ns = default_cost_ns;
+	}
+	if (producer_count <= 0)
+		producer_count = (int) max_producer + 1;
+
+	//events in flight never exceed queue capacity + the one being handled
+	replay_context rc;
+	rc.stamps.resize(2 * (size_t) queue_capacity);
+	rc.enqueued = 0;
+	rc.enqueued_count.store(0);
+	rc.handled = 0;
+	rc.handled_count.store(0);
+	rc.latency_ns.reserve(records.size());
+	rc.accepted_latency_ns.reserve(records.size());
+
+	std::unique_ptr<el_async::AsyncEventHandler::handler_params[]> event_handler_param_table(
+			new el_async::AsyncEventHandler::handler_params[event_capacity]());
+	std::vector<int> event_handler_event_queue(queue_capacity, 0);
+	std::thread event_handler_thread;
+
+	el_async::AsyncEventHandler event_handler;
+	event_handler.event_bind_param_table_memory(
+			(void*) event_handler_param_table.get(),
+			event_capacity * sizeof(el_async::AsyncEventHandler::handler_params));
+	event_handler.event_queue_bind_memory(event_handler_event_queue.data(),
+			queue_capacity);
+	event_handler.handler_bind(replay_handler_function);
+	event_handler.trigger_hook_bind(replay_trigger_hook, &rc);
+	event_handler.thread_bind(&event_handler_thread);
+	event_handler.thread_start();
+	for (int i = 0; i < event_capacity; i++) {
+		event_handler.event_bind(i, &rc, 0, i, 0);
+		event_handler.event_enable(i);
+	}
+	event_handler.event_queue_enable();
+	while (!event_handler.thread_ready())
+		;
+	int error = event_handler.error();
+	if (error != 0) {
+		std::cout << "replay: configuration failed, error " << error << std::endl;
+		return 1;
+	}
+
+	std::vector<std::vector<const el_async::event_trace_record*>> per_producer(
+			producer_count);
+	for (const el_async::event_trace_record &r : records)
+		per_producer[r.producer % producer_count].push_back(&r);
+
+	std::atomic<long long> queue_full_count(0);
+	std::atomic<long long> dropped_count(0);
+	std::atomic<bool> sampling(true);
+	std::vector<replay_depth_sample> depth_samples;
+	replay_clock::time_point start = replay_clock::now() + std::chrono::milliseconds(10);
+
+	std::thread sampler([&]() {
+		replay_clock::time_point next = start;
+		while (sampling.load(std::memory_order_relaxed)) {
+			std::this_thread::sleep_until(next);
+			long long depth = rc.enqueued_count.load(std::memory_order_acquire)
+					- rc.handled_count.load(std::memory_order_acquire);
+			double t_ms = std::chrono::duration<double, std::milli>(
+					replay_clock::now() - start).count();
+			depth_samples.push_back( { t_ms, depth });
+			next += std::chrono::microseconds(sample_us);
+		}
+	});
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < producer_count; p++) {
+		producers.emplace_back([&, p]() {
+			long long queue_full = 0;
+			long long dropped = 0;
+			for (const el_async::event_trace_record *r : per_producer[p]) {
+				if (!fast) {
+					replay_clock::time_point due = start
+							+ std::chrono::nanoseconds(r->timestamp_ns);
+					if (due - replay_clock::now() > std::chrono::microseconds(200))
+						std::this_thread::sleep_until(due - std::chrono::microseconds(100));
+					while (replay_clock::now() < due)
+						;
+					replay_pending_due = due; //if we're late, that counts too
+				} else {
+					while (replay_clock::now() < start)
+						;
+					replay_pending_due = replay_clock::now();
+				}
+				replay_pending_cost_ns = r->cost_ns;
+				while (!event_handler.event_trigger(r->event)) {
+					//error code is shared by all producers, someone else's may be the one we clear
+					int err = event_handler.error();
+					if (err != 0 && err != el_async::AsyncEventHandler::EventQueueFull) {
+						dropped++;
+						break;
+					}
+					queue_full++;
+					event_handler.event_queue_enable(); //wake the handler thread in case it slept through the error
+					std::this_thread::yield();
+				}
+			}
+			queue_full_count.fetch_add(queue_full);
+			dropped_count.fetch_add(dropped);
+		});
+	}
+	for (std::thread &p : producers)
+		p.join();
+	replay_clock::time_point producers_done = replay_clock::now();
+
+	long long expected = (long long) records.size() - dropped_count.load();
+	while (rc.handled_count.load(std::memory_order_acquire) < expected) {
+		if (replay_clock::now() - producers_done > std::chrono::seconds(10)) {
+			std::cout << "replay: handler didn't drain the queue in 10 s" << std::endl;
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	replay_clock::time_point end = replay_clock::now();
+	sampling.store(false);
+	sampler.join();
+	event_handler.thread_stop_join();
+	event_handler.trigger_hook_unbind();
+
+	double wall_s = std::chrono::duration<double>(end - start).count();
+	long long handled = rc.handled_count.load();
+	std::vector<uint64_t> sorted = rc.latency_ns;
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<uint64_t> sorted_accepted = rc.accepted_latency_ns;
+	std::sort(sorted_accepted.begin(), sorted_accepted.end());
+
+	long long depth_max = 0;
+	double depth_sum = 0.0;
+	for (const replay_depth_sample &s : depth_samples) {
+		depth_max = std::max(depth_max, s.depth);
+		depth_sum += (double) s.depth;
+	}
+
+	std::cout << "replay: " << records.size() << " records, " << producer_count
+			<< " producers, event capacity " << event_capacity
+			<< ", queue capacity " << queue_capacity
+			<< (fast ? ", as fast as possible" : ", real speed") << std::endl;
+	std::cout << "replay: wall time:       " << wall_s << " s" << std::endl;
+	std::cout << "replay: handled:         " << handled << " ("
+			<< (long long) (handled / wall_s) << " /s)" << std::endl;
+	std::cout << "replay: queue full:      " << queue_full_count.load()
+			<< " retries" << std::endl;
+	std::cout << "replay: dropped:         " << dropped_count.load() << std::endl;
+	std::cout << "replay: latency us:      p50 " << replay_percentile_us(sorted, 0.50)
+			<< ", p90 " << replay_percentile_us(sorted, 0.90)
+			<< ", p99 " << replay_percentile_us(sorted, 0.99)
+			<< ", p99.9 " << replay_percentile_us(sorted, 0.999)
+			<< ", max " << replay_percentile_us(sorted, 1.0) << " (due -> handled)"
+			<< std::endl;
+	std::cout << "replay: latency us:      p50 "
+			<< replay_percentile_us(sorted_accepted, 0.50)
+			<< ", p90 " << replay_percentile_us(sorted_accepted, 0.90)
+			<< ", p99 " << replay_percentile_us(sorted_accepted, 0.99)
+			<< ", p99.9 " << replay_percentile_us(sorted_accepted, 0.999)
+			<< ", max " << replay_percentile_us(sorted_accepted, 1.0)
+			<< " (accepted -> handled)" << std::endl;
+	std::cout << "replay: queue depth:     max " << depth_max << ", mean "
+			<< (depth_samples.empty() ? 0.0 : depth_sum / depth_samples.size())
+			<< " (" << depth_samples.size() << " samples every " << sample_us
+			<< " us)" << std::endl;
+
+	//coarse series on stdout, max depth per bucket
+	size_t bucket_count = std::min<size_t>(20, depth_samples.size());
+	for (size_t b = 0; b < bucket_count; b++) {
+		size_t from = b * depth_samples.size() / bucket_count;
+		size_t to = (b + 1) * depth_samples.size() / bucket_count;
+		long long bucket_max = 0;
+		for (size_t i = from; i < to; i++)
+			bucket_max = std::max(bucket_max, depth_samples[i].depth);
+		std::printf("replay: depth @ %9.3f ms: %lld\n", depth_samples[from].t_ms,
+				bucket_max);
+	}
+
+	if (depth_out_path != nullptr) {
+		FILE *f = std::fopen(depth_out_path, "w");
+		if (f == nullptr) {
+			std::cout << "replay: can't write " << depth_out_path << std::endl;
+			return 1;
+		}
+		std::fprintf(f, "t_ms,depth\n");
+		for (const replay_depth_sample &s : depth_samples)
+			std::fprintf(f, "%.3f,%lld\n", s.t_ms, s.depth);
+		std::fclose(f);
+	}
+	return 0;
+}
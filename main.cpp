@@ -15,6 +15,14 @@ void event_handler_function(void *arg0, void *arg1, int arg2, int arg3) {
 				<< "asyncEventHandlerEvent: event 1. This is a dedicated event one message."
 				<< std::endl;
 		break;
+	case (4):
+		std::cout
+				<< "asyncEventHandlerEvent: event 4. Continuing with events 1 and 0 inline."
+				<< std::endl;
+		//arg0 carries the handler object, continuations are only allowed from the handler thread
+		((el_async::AsyncEventHandler*) arg0)->event_continue(1);
+		((el_async::AsyncEventHandler*) arg0)->event_continue(0);
+		break;
 	default:
 		std::cout << "asyncEventHandlerEvent: event " << int(arg2) << "."
 				<< std::endl;
@@ -33,6 +41,7 @@ int main() {
 	//void** event_handler_param_table_mem_auto_aligned[128] = {0}; //declaring an array of pointers will result in correct alignment
 	el_async::AsyncEventHandler::handler_params event_handler_param_table[16]; //specifying length explicitly
 	int event_handler_event_queue[32] = { 0 }; //create event queue just as an array of event numbers (used as a ring buffer)
+	int event_handler_continuation_stack[8] = { 0 }; //continuations pushed from inside the handler, executed right after it returns
 	std::thread my_event_handler_thread; //thread object can be anywhere
 
 	//Step 1: create object
@@ -51,11 +60,17 @@ int main() {
 	my_event_handler.event_queue_bind_memory(event_handler_event_queue,
 			sizeof(event_handler_event_queue)
 					/ sizeof(event_handler_event_queue[0]));
+	my_event_handler.event_continuation_bind_memory(event_handler_continuation_stack,
+			sizeof(event_handler_continuation_stack)
+					/ sizeof(event_handler_continuation_stack[0])); //optional
+	my_event_handler.event_continuation_depth_limit(4); //past 4 inline continuations fall back to the event queue, set before thread_start()
+	my_event_handler.event_continuation_order(el_async::AsyncEventHandler::ContinuationFIFO); //default is LIFO, set before thread_start()
 	my_event_handler.handler_bind(event_handler_function);
 	my_event_handler.thread_bind(&my_event_handler_thread);
 
 	std::cout << "Config: total number of events: " << int(my_event_handler.event_capacity()) << std::endl;
 	std::cout << "Config: event queue capacity: " << int(my_event_handler.event_queue_capacity()) << std::endl;
+	std::cout << "Config: continuation stack capacity: " << int(my_event_handler.event_continuation_capacity()) << std::endl;
 
 	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
@@ -82,6 +97,7 @@ int main() {
 	my_event_handler.event_bind(1, 0, 0, 1, 0);
 	my_event_handler.event_bind(2, 0, 0, 2, 0);
 	my_event_handler.event_bind(3, 0, 0, 3, 0);
+	my_event_handler.event_bind(4, (void*) &my_event_handler, 0, 4, 0); //handler continues with other events
 	my_event_handler.event_bind(-1, 0, 0, -1, 0);
 	my_event_handler.event_bind(-2, 0, 0, -2, 0);
 	my_event_handler.event_bind(-3, 0, 0, -3, 0); //place into event my_event_handler.event_capacity() - 3
@@ -103,6 +119,7 @@ int main() {
 	my_event_handler.event_enable(1);
 	my_event_handler.event_enable(2);
 	//my_event_handler.event_enable(3); //didn't enable event 3
+	my_event_handler.event_enable(4);
 	my_event_handler.event_enable(-1);
 	my_event_handler.event_enable(-2);
 	my_event_handler.event_enable(-3);
@@ -183,6 +200,25 @@ int main() {
 	my_event_handler.event_queue_enable();
 	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
+	std::cout << "Test: continuations, event 4 handler continues with events 1 and 0"
+			<< std::endl;
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+	my_event_handler.event_trigger(4);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+	std::cout << "Test: continuing outside of the handler thread"
+			<< std::endl;
+	my_event_handler.event_continue(1); //not the handler thread, will set error code
+	if ((error = my_event_handler.error()) != 0) {
+		//error handling
+		//error code in the object is cleared
+		std::cout << "asyncEventHandlerError: error " << int(error)
+				<< std::endl;
+
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
 	std::cout << "Test: misconfiguring to see error flags at work "
 			<< std::endl;
 	std::this_thread::sleep_for(std::chrono::milliseconds(1000));